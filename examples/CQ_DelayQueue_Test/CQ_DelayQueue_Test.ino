@@ -0,0 +1,69 @@
+#include <MD_CirDelayQueue.h>
+
+const uint8_t BUCKETS = 8;
+const uint8_t BUCKET_SIZE = 4;
+const uint16_t TICK = 10;   // ms
+
+// Define a delay queue of unsigned 32 bit values, with delays up to 80ms.
+MD_CirDelayQueue Q(BUCKETS, BUCKET_SIZE, sizeof(uint32_t), TICK);
+
+// Push a value to be ready after the delay given and show the result.
+void pushDelay(uint32_t i, uint32_t delayTime)
+{
+  bool b;
+
+  b = Q.push((uint8_t *)&i, millis() + delayTime);
+  Serial.print("\nPush ");
+  Serial.print(i);
+  Serial.print(" delay ");
+  Serial.print(delayTime);
+  Serial.print(b ? " ok" : " fail");
+}
+
+// Pop items until the queue is empty, showing when each is ready.
+void popAll(uint32_t start)
+{
+  while (!Q.isEmpty())
+  {
+    uint32_t  n;
+
+    if (Q.pop((uint8_t *)&n) != NULL)
+    {
+      Serial.print("\nPopped ");
+      Serial.print(n);
+      Serial.print(" after ");
+      Serial.print(millis() - start);
+    }
+  }
+}
+
+void setup()
+{
+  uint32_t start;
+
+  Serial.begin(57600);
+  Serial.print("\n[CQ_DelayQueue_Test]");
+
+  Q.begin();
+
+  // Delays up to the range of the timing wheel can be queued.
+  start = millis();
+  pushDelay(1, 50);
+  pushDelay(2, 5);
+  pushDelay(3, 70);
+  pushDelay(4, BUCKETS * TICK);   // fails, too far ahead
+  popAll(start);
+
+  // The consumer does not call pop() for longer than the range of the wheel,
+  // but short delays can still be queued.
+  Serial.print("\n\nLagging consumer");
+  start = millis();
+  pushDelay(5, 70);
+  delay(100);
+  pushDelay(6, 10);   // ok, push() moves the wheel on to the bucket of item 5
+  popAll(start);
+}
+
+void loop()
+{
+}
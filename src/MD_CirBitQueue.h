@@ -0,0 +1,275 @@
+#pragma once
+
+#include <MD_CirQueue.h>
+
+/**
+ * \file
+ * \brief Header file and class definition for the MD_CirBitQueue packed integer queue
+ */
+
+/**
+ * Bit packed integer queue for the MD_CirQueue library
+ *
+ * MD_CirQueue stores each item in a whole number of bytes. Values that need fewer
+ * bits, such as 10 or 12 bit ADC samples, waste part of every item. This queue
+ * stores unsigned values of 1 to 32 bits packed one after the other in memory,
+ * so the same memory holds more values (eg, 60% more 10 bit samples than if
+ * they were stored in 2 bytes).
+ *
+ * Values are pushed and popped in FIFO order and the same full queue behavior as
+ * MD_CirQueue is available using setFullOverwrite(). Bits of a value beyond the
+ * width specified are discarded by push().
+ */
+class MD_CirBitQueue
+{
+public:
+  /**
+   * Class Constructor.
+   *
+   * Instantiate a new instance of the class. The parameters passed are used to
+   * configure the quantity and width of the values in the queue.
+   *
+   * \param itmQty    number of values allowed in the queue. If the buffer cannot be allocated the queue has no space and push() fails.
+   * \param itmBits   size of each value in bits, 1 to 32.
+   */
+  MD_CirBitQueue(uint16_t itmQty, uint8_t itmBits) :
+    _itmQty(itmQty), _itmBits(itmBits == 0 ? 1 : (itmBits > 32 ? 32 : itmBits)),
+    _itmCount(0), _overwrite(false)
+  {
+    uint32_t size = ((uint32_t)_itmQty * _itmBits + 7) / 8;
+
+    CQ_PRINT("\nAllocating ", size);
+    CQ_PRINTS("bytes");
+    // a size too large for malloc() on this processor is an allocation failure
+    _itmData = ((size_t)size == size) ? (uint8_t *)malloc(size) : NULL;
+    if (_itmData == NULL) _itmQty = 0;
+    clear();
+  }
+
+  /**
+   * Class Destructor.
+   *
+   * Released allocated memory and does the necessary to clean up once the queue is
+   * no longer required.
+   */
+  ~MD_CirBitQueue()
+  {
+    free(_itmData);
+  }
+
+  /**
+   * Initialize the object.
+   *
+   * Initialize the object data. This needs to be called during setup() to initialize new
+   * data for the class that cannot be done during the object creation.
+   */
+  void begin(void) {};
+
+ /**
+  * Clear contents of buffer
+  *
+  * Clears the buffer by resetting the head and tail pointers. Does not zero out delete
+  * data in the buffer.
+  */
+  inline void clear() { _idxPut = _idxTake = _itmCount = 0; };
+
+ /**
+  * Push a value into the queue
+  *
+  * Place the value passed into the end of the queue. If the buffer is already full
+  * before the push(), the behavior will depend on the the setting controlled by the
+  * setFullOverwrite() method.
+  *
+  * @param v      the value to be saved.
+  * @return true  if the value was successfully placed in the queue, false otherwise
+  */
+  bool push(uint32_t v)
+  {
+    if (_itmQty == 0) return(false);
+    if (isFull())
+    {
+      if (!_overwrite) return(false);
+
+      CQ_PRINTS("\nOverwriting Q");
+      if (++_idxTake == _itmQty) _idxTake = 0;
+      _itmCount--;
+    }
+
+    CQ_PRINT("\nPush @", _idxPut);
+    putBits(_idxPut, v);
+    if (++_idxPut == _itmQty) _idxPut = 0;
+    _itmCount++;
+
+    return(true);
+  }
+
+ /**
+  * Pop a value from the queue
+  *
+  * Return the first available value in the queue.
+  *
+  * @param v      a pointer to the variable for the retrieved value.
+  * @return true  if a value was returned, false if the queue is empty
+  */
+  bool pop(uint32_t* v)
+  {
+    if (!peek(v)) return(false);
+
+    CQ_PRINT("\nPop @", _idxTake);
+    if (++_idxTake == _itmQty) _idxTake = 0;
+    _itmCount--;
+
+    return(true);
+  }
+
+ /**
+  * Peek at the next value in the queue
+  *
+  * Return the first available value in the queue without removing it.
+  *
+  * @param v      a pointer to the variable for the retrieved value.
+  * @return true  if a value was returned, false if the queue is empty
+  */
+  bool peek(uint32_t* v)
+  {
+    if (isEmpty()) return(false);
+
+    *v = getBits(_idxTake);
+
+    return(true);
+  }
+
+ /**
+  * Push a block of values into the queue
+  *
+  * Place the values from the array passed into the end of the queue, in order,
+  * as for push().
+  *
+  * @param v      the array of values to be saved.
+  * @param n      the number of values in the array.
+  * @return the number of values placed in the queue
+  */
+  uint16_t pushBulk(const uint32_t* v, uint16_t n)
+  {
+    uint16_t i;
+
+    for (i = 0; i < n; i++)
+      if (!push(v[i])) break;
+
+    return(i);
+  }
+
+ /**
+  * Pop a block of values from the queue
+  *
+  * Remove up to n values from the head of the queue into the array passed, in
+  * FIFO order.
+  *
+  * @param v      the array for the retrieved values.
+  * @param n      the size of the array.
+  * @return the number of values retrieved
+  */
+  uint16_t popBulk(uint32_t* v, uint16_t n)
+  {
+    uint16_t i;
+
+    for (i = 0; i < n; i++)
+      if (!pop(&v[i])) break;
+
+    return(i);
+  }
+
+ /**
+  * Set queue full behavior
+  *
+  * If the setting is set true, then push() with a full queue will overwrite the
+  * oldest value in the queue. Default behavior is not to overwrite the oldest value
+  * and fail the push() attempt.
+  *
+  * @param b  true to overwrite oldest value, false (default) to fail the push() call
+  */
+  inline void setFullOverwrite(bool b) { _overwrite = b; };
+
+ /**
+  * Get the number of values in the queue
+  *
+  * @return the number of values in the queue
+  */
+  inline uint16_t getCount(void) { return(_itmCount); };
+
+ /**
+  * Check if the buffer is empty
+  *
+  * @return true if empty, false otherwise
+  */
+  inline bool isEmpty(void) { return(_itmCount == 0); };
+
+ /**
+  * Check if the buffer is full
+  *
+  * @return true if full, false otherwise
+  */
+  inline bool isFull() { return (_itmCount != 0 && _itmCount == _itmQty); };
+
+private:
+ /**
+  * Write a value into the bit field for an array index.
+  */
+  void putBits(uint16_t idx, uint32_t v)
+  {
+    uint32_t bit = (uint32_t)idx * _itmBits;
+    uint8_t* p = _itmData + (bit >> 3);
+    uint8_t shift = bit & 7;
+    uint8_t n = _itmBits;
+
+    while (n != 0)
+    {
+      uint8_t len = 8 - shift;
+
+      if (len > n) len = n;
+
+      uint8_t mask = ((1 << len) - 1) << shift;
+
+      *p = (*p & ~mask) | ((uint8_t)(v << shift) & mask);
+      v >>= len;
+      n -= len;
+      shift = 0;
+      p++;
+    }
+  }
+
+ /**
+  * Read the value from the bit field for an array index.
+  */
+  uint32_t getBits(uint16_t idx)
+  {
+    uint32_t bit = (uint32_t)idx * _itmBits;
+    uint8_t* p = _itmData + (bit >> 3);
+    uint8_t shift = bit & 7;
+    uint8_t n = 0;
+    uint32_t v = 0;
+
+    while (n < _itmBits)
+    {
+      uint8_t len = 8 - shift;
+
+      if (len > _itmBits - n) len = _itmBits - n;
+
+      v |= (uint32_t)((*p >> shift) & ((1 << len) - 1)) << n;
+      n += len;
+      shift = 0;
+      p++;
+    }
+
+    return(v);
+  }
+
+  uint16_t  _itmQty;    /// number of values in the queue
+  uint8_t   _itmBits;   /// size in bits for each value
+  uint8_t*  _itmData;   /// pointer to allocated memory buffer
+
+  uint16_t  _itmCount;  /// number of values in the queue
+  uint16_t  _idxPut;    /// array index where the next push will occur
+  uint16_t  _idxTake;   /// array index where next pop will occur
+  bool      _overwrite; /// when true, overwrite oldest value if push() and isFull()
+};
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <MD_CirQueue.h>
+
+/**
+ * \file
+ * \brief Header file and class definition for the MD_CirDelayQueue delay queue
+ */
+
+/**
+ * Delay queue for the MD_CirQueue library
+ *
+ * Each item is pushed with the time at which it becomes ready, and pop() only
+ * returns items whose ready time has passed. This suits retry backoff and other
+ * delayed work without having to pop, check and push back items that are not
+ * yet due.
+ *
+ * The queue is a timing wheel - a ring of MD_CirQueue buckets, one for each tick
+ * of time. An item is pushed into the bucket for its ready time and pop() works
+ * through the buckets as time passes, so both are quick irrespective of the
+ * number of items queued. Items are never returned before their ready time, but
+ * may be held up by less than one tick behind an item pushed earlier into the
+ * same bucket. The longest delay that can be queued is the number of buckets
+ * times the tick, less the time the oldest ready item has been left in the queue.
+ * All times allow for millis() rollover.
+ */
+class MD_CirDelayQueue
+{
+public:
+  /**
+   * Class Constructor.
+   *
+   * Instantiate a new instance of the class. The parameters passed are used to
+   * configure the timing wheel and the quantity and size of queue objects.
+   *
+   * \param bktQty    number of buckets (ticks) in the timing wheel.
+   * \param itmQty    number of items allowed in each bucket.
+   * \param itmSize   size of each item in bytes.
+   * \param tick      duration of each bucket in milliseconds.
+   */
+  MD_CirDelayQueue(uint8_t bktQty, uint8_t itmQty, uint16_t itmSize, uint16_t tick) :
+    _bktQty(bktQty == 0 ? 1 : bktQty), _itmSize(itmSize), _tick(tick == 0 ? 1 : tick)
+  {
+    CQ_PRINT("\nAllocating buckets ", _bktQty);
+    _bkt = (MD_CirQueue **)malloc(sizeof(MD_CirQueue *) * _bktQty);
+    for (uint8_t i = 0; i < _bktQty; i++)
+      _bkt[i] = new MD_CirQueue(itmQty, sizeof(uint32_t) + _itmSize);
+    clear();
+  }
+
+  /**
+   * Class Destructor.
+   *
+   * Released allocated memory and does the necessary to clean up once the queue is
+   * no longer required.
+   */
+  ~MD_CirDelayQueue()
+  {
+    for (uint8_t i = 0; i < _bktQty; i++)
+      delete _bkt[i];
+    free(_bkt);
+  }
+
+  /**
+   * Initialize the object.
+   *
+   * Initialize the object data. This needs to be called during setup() to initialize new
+   * data for the class that cannot be done during the object creation.
+   */
+  void begin(void) {};
+
+ /**
+  * Clear contents of buffer
+  *
+  * Discards all the items in the queue.
+  */
+  void clear(void)
+  {
+    for (uint8_t i = 0; i < _bktQty; i++)
+      _bkt[i]->clear();
+    _itmCount = 0;
+    _idxCur = 0;
+    _timeCur = millis();
+  }
+
+ /**
+  * Push an item into the queue
+  *
+  * Place the item passed into the queue, to be returned by pop() once the time
+  * specified has passed. Items with a time that has already passed are ready
+  * immediately. The push fails if the time is beyond the range of the timing
+  * wheel or the bucket for that time is full.
+  *
+  * @param itm      a pointer to data buffer of the item to be saved. Data size must be size specified in the constructor.
+  * @param readyAt  the millis() time at which the item becomes ready.
+  * @return true  if the item was successfully placed in the queue, false otherwise
+  */
+  bool push(uint8_t* itm, uint32_t readyAt)
+  {
+    uint32_t t;
+
+    // an empty wheel can start again from the current time, otherwise catch up
+    // with the time if pop() has not been called for a while
+    if (_itmCount == 0) _timeCur = millis();
+    else advance(millis(), &t);
+
+    // times already passed are ready in the current bucket
+    if ((int32_t)(readyAt - _timeCur) < 0) readyAt = _timeCur;
+
+    uint32_t ticks = (readyAt - _timeCur) / _tick;
+
+    if (ticks >= _bktQty) return(false);
+
+    uint16_t idx = _idxCur + ticks;
+
+    if (idx >= _bktQty) idx -= _bktQty;
+
+    MD_CirQueue::fragment_t f[2] = { { (uint8_t *)&readyAt, sizeof(readyAt) }, { itm, _itmSize } };
+
+    CQ_PRINT("\nPush bucket ", idx);
+    if (!_bkt[idx]->pushv(f, 2)) return(false);
+    _itmCount++;
+
+    return(true);
+  }
+
+ /**
+  * Pop a ready item from the queue
+  *
+  * Return the first item whose ready time has passed, copied into the buffer specified,
+  * returning a pointer to the copied item. If no items are ready, then no data is
+  * copied and the method returns a NULL pointer.
+  *
+  * @param itm  a pointer to data buffer for the retrieved item to be saved. Data size must be size specified in the constructor.
+  * @return pointer to the memory buffer or NULL if no item is ready
+  */
+  uint8_t *pop(uint8_t* itm)
+  {
+    uint32_t now = millis();
+    uint32_t t;
+
+    if (!advance(now, &t) || (int32_t)(now - t) < 0) return(NULL);
+
+    MD_CirQueue::fragment_t f[2] = { { (uint8_t *)&t, sizeof(t) }, { itm, _itmSize } };
+
+    CQ_PRINT("\nPop bucket ", _idxCur);
+    _bkt[_idxCur]->popv(f, 2);
+    _itmCount--;
+
+    return(itm);
+  }
+
+ /**
+  * Get the number of items in the queue
+  *
+  * @return the number of items in the queue, ready or not
+  */
+  inline uint16_t getCount(void) { return(_itmCount); };
+
+ /**
+  * Check if the queue is empty
+  *
+  * @return true if empty, false otherwise
+  */
+  inline bool isEmpty(void) { return(_itmCount == 0); };
+
+private:
+ /**
+  * Move the bucket being emptied forward towards the time given, over buckets
+  * with no items for this turn of the wheel.
+  *
+  * @param now  the current time.
+  * @param t    a pointer to a variable to receive the ready time of the first item in the bucket.
+  * @return true if the bucket has an item for this turn of the wheel, false otherwise
+  */
+  bool advance(uint32_t now, uint32_t* t)
+  {
+    while (_itmCount != 0 && (int32_t)(now - _timeCur) >= 0)
+    {
+      // items for later turns of the wheel queue behind those for this one
+      if (_bkt[_idxCur]->peekField(0, 0, sizeof(*t), (uint8_t *)t) != NULL && *t - _timeCur < _tick)
+        return(true);
+
+      // nothing more due in this bucket
+      if (now - _timeCur < _tick) break;
+      _timeCur += _tick;
+      if (++_idxCur == _bktQty) _idxCur = 0;
+    }
+
+    return(false);
+  }
+
+  uint8_t       _bktQty;    /// number of buckets in the timing wheel
+  uint16_t      _itmSize;   /// size in bytes for each item
+  uint16_t      _tick;      /// duration of a bucket in milliseconds
+  MD_CirQueue** _bkt;       /// pointer to allocated array of bucket queues
+
+  uint16_t      _itmCount;  /// number of items in all the buckets
+  uint8_t       _idxCur;    /// index of the bucket being emptied by pop()
+  uint32_t      _timeCur;   /// millis() time at the start of the bucket being emptied by pop()
+};
@@ -0,0 +1,268 @@
+#pragma once
+
+#include <MD_CirQueue.h>
+
+/**
+ * \file
+ * \brief Header file and class definition for the MD_CirDeltaQueue compressed queue
+ */
+
+/**
+ * Delta compressed integer queue for the MD_CirQueue library
+ *
+ * For slowly changing values (eg, temperature or other trend data) most of the
+ * bytes stored in a queue of plain integers are the same from one value to the
+ * next. This queue stores each signed 32 bit value as the difference from the
+ * value before it, using as few bytes as the difference needs (1 byte for changes
+ * up to +/-63), so the same memory can hold many more values.
+ *
+ * The memory is divided into a number of fixed size blocks. Each block starts with
+ * the full value of its first item, so blocks can be decoded independently. When
+ * all the blocks are in use and setFullOverwrite() is enabled, the oldest block is
+ * discarded in one step to make room for new values, so push() always takes the
+ * same time.
+ */
+class MD_CirDeltaQueue
+{
+public:
+  /**
+   * Class Constructor.
+   *
+   * Instantiate a new instance of the class. The parameters passed are used to
+   * configure the quantity and size of the memory blocks.
+   *
+   * \param blkQty    number of memory blocks, at least 1.
+   * \param blkSize   size of each block in bytes, at least 10. Larger blocks compress better but discard more values when overwritten.
+   */
+  MD_CirDeltaQueue(uint8_t blkQty, uint16_t blkSize) :
+    _blkQty(blkQty == 0 ? 1 : blkQty), _blkSize(blkSize < BLK_MIN_SIZE ? BLK_MIN_SIZE : blkSize),
+    _overwrite(false)
+  {
+    uint16_t size = sizeof(uint8_t) * _blkQty * _blkSize;
+
+    CQ_PRINT("\nAllocating ", size);
+    CQ_PRINTS("bytes");
+    _blkData = (uint8_t *)malloc(size);
+    clear();
+  }
+
+  /**
+   * Class Destructor.
+   *
+   * Released allocated memory and does the necessary to clean up once the queue is
+   * no longer required.
+   */
+  ~MD_CirDeltaQueue()
+  {
+    free(_blkData);
+  }
+
+  /**
+   * Initialize the object.
+   *
+   * Initialize the object data. This needs to be called during setup() to initialize new
+   * data for the class that cannot be done during the object creation.
+   */
+  void begin(void) {};
+
+ /**
+  * Clear contents of buffer
+  *
+  * Clears the buffer by resetting the head and tail pointers. Does not zero out delete
+  * data in the buffer.
+  */
+  inline void clear() { _blkPut = _blkTake = _blkCount = 0; _itmCount = 0; _takeIdx = 0; };
+
+ /**
+  * Push a value into the queue
+  *
+  * Place the value passed into the end of the queue. If there is no space left in
+  * the buffer, the behavior will depend on the the setting controlled by the
+  * setFullOverwrite() method.
+  *
+  * @param v      the value to be saved.
+  * @return true  if the value was successfully placed in the queue, false otherwise
+  */
+  bool push(int32_t v)
+  {
+    if (_blkCount != 0)
+    {
+      uint8_t* blk = getBlock(_blkPut);
+      uint32_t zz = zigzag((uint32_t)v - (uint32_t)_putLast);
+      uint8_t len = varintLen(zz);
+
+      if (blk[0] < 0xff && _putOfs + len <= _blkSize)
+      {
+        // append to the current block
+        CQ_PRINT("\nPush @", _blkPut);
+        putVarint(blk + _putOfs, zz);
+        _putOfs += len;
+        blk[0]++;
+        _putLast = v;
+        _itmCount++;
+        return(true);
+      }
+
+      // no space for another block, so discard the oldest block
+      if (_blkCount == _blkQty)
+      {
+        if (!_overwrite) return(false);
+
+        CQ_PRINT("\nOverwriting block ", _blkTake);
+        _itmCount -= getBlock(_blkTake)[0] - _takeIdx;
+        dropBlock();
+      }
+    }
+
+    // start a new block with the full value
+    _blkPut = (_blkCount == 0) ? _blkTake : nextBlock(_blkPut);
+    _blkCount++;
+    CQ_PRINT("\nPush new block @", _blkPut);
+
+    uint8_t* blk = getBlock(_blkPut);
+
+    blk[0] = 1;
+    memcpy(blk + 1, &v, sizeof(v));
+    _putOfs = BLK_HDR_SIZE;
+    _putLast = v;
+    _itmCount++;
+
+    return(true);
+  }
+
+ /**
+  * Pop a value from the queue
+  *
+  * Return the first available value in the queue.
+  *
+  * @param v      a pointer to the variable for the retrieved value.
+  * @return true  if a value was returned, false if the queue is empty
+  */
+  bool pop(int32_t* v)
+  {
+    if (isEmpty()) return(false);
+
+    uint8_t* blk = getBlock(_blkTake);
+
+    CQ_PRINT("\nPop @", _blkTake);
+    if (_takeIdx == 0)
+    {
+      memcpy(&_takeLast, blk + 1, sizeof(_takeLast));
+      _takeOfs = BLK_HDR_SIZE;
+    }
+    else
+    {
+      uint32_t zz;
+
+      _takeOfs += getVarint(blk + _takeOfs, &zz);
+      _takeLast = (int32_t)((uint32_t)_takeLast + unzigzag(zz));
+    }
+    *v = _takeLast;
+    _takeIdx++;
+    _itmCount--;
+
+    // move on when the head block is used up
+    if (_takeIdx == blk[0])
+    {
+      dropBlock();
+      if (_blkCount == 0) _blkTake = _blkPut;
+    }
+
+    return(true);
+  }
+
+ /**
+  * Set queue full behavior
+  *
+  * If the setting is set true, then push() with a full queue will discard the
+  * oldest block of values in the queue. Default behavior is not to overwrite the
+  * oldest values and fail the push() attempt.
+  *
+  * @param b  true to overwrite oldest values, false (default) to fail the push() call
+  */
+  inline void setFullOverwrite(bool b) { _overwrite = b; };
+
+ /**
+  * Get the number of values in the queue
+  *
+  * @return the number of values in the queue
+  */
+  inline uint16_t getCount(void) { return(_itmCount); };
+
+ /**
+  * Check if the buffer is empty
+  *
+  * @return true if empty, false otherwise
+  */
+  inline bool isEmpty(void) { return(_itmCount == 0); };
+
+private:
+  static const uint8_t BLK_HDR_SIZE = 1 + sizeof(int32_t);   ///< item count and first value
+  static const uint8_t BLK_MIN_SIZE = BLK_HDR_SIZE + 5;      ///< header and one largest delta
+
+  inline uint8_t* getBlock(uint8_t blk) { return(_blkData + (_blkSize * blk)); };
+  inline uint8_t nextBlock(uint8_t blk) { return(blk + 1 == _blkQty ? 0 : blk + 1); };
+
+ /**
+  * Discard the block at the head of the queue.
+  */
+  inline void dropBlock(void)
+  {
+    _blkTake = nextBlock(_blkTake);
+    _blkCount--;
+    _takeIdx = 0;
+  }
+
+  // Map signed differences to unsigned so small changes either way are small numbers
+  static inline uint32_t zigzag(uint32_t d)   { return((d << 1) ^ (uint32_t)((int32_t)d >> 31)); };
+  static inline uint32_t unzigzag(uint32_t z) { return((z >> 1) ^ (uint32_t)(-(int32_t)(z & 1))); };
+
+  // Variable length encoding, 7 bits per byte with the top bit set if more bytes follow
+  static uint8_t varintLen(uint32_t z)
+  {
+    uint8_t len = 1;
+
+    while (z >= 0x80) { z >>= 7; len++; }
+    return(len);
+  }
+
+  static void putVarint(uint8_t* p, uint32_t z)
+  {
+    while (z >= 0x80)
+    {
+      *p++ = (z & 0x7f) | 0x80;
+      z >>= 7;
+    }
+    *p = z;
+  }
+
+  static uint8_t getVarint(uint8_t* p, uint32_t* z)
+  {
+    uint8_t len = 0;
+    uint8_t shift = 0;
+
+    *z = 0;
+    do
+    {
+      *z |= (uint32_t)(p[len] & 0x7f) << shift;
+      shift += 7;
+    } while (p[len++] & 0x80);
+
+    return(len);
+  }
+
+  uint8_t   _blkQty;    /// number of blocks in the buffer
+  uint16_t  _blkSize;   /// size in bytes for each block
+  uint8_t*  _blkData;   /// pointer to allocated memory buffer
+
+  uint16_t  _itmCount;  /// number of values in the queue
+  uint8_t   _blkCount;  /// number of blocks in use
+  uint8_t   _blkPut;    /// block where the next push will occur
+  uint16_t  _putOfs;    /// byte offset in _blkPut for the next push
+  int32_t   _putLast;   /// last value pushed
+  uint8_t   _blkTake;   /// block where next pop will occur
+  uint8_t   _takeIdx;   /// number of values already popped from _blkTake
+  uint16_t  _takeOfs;   /// byte offset in _blkTake of the next delta to pop
+  int32_t   _takeLast;  /// last value popped
+  bool      _overwrite; /// when true, discard oldest block if push() and buffer is full
+};
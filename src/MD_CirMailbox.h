@@ -0,0 +1,140 @@
+#pragma once
+
+#include <MD_CirQueue.h>
+
+/**
+ * \file
+ * \brief Header file and class definition for the MD_CirMailbox latest value mailbox
+ */
+
+/**
+ * Latest value mailbox for the MD_CirQueue library
+ *
+ * Where only the most recent value of some data matters (eg, a control loop
+ * setpoint), a mailbox is a better fit than a queue with one item and
+ * setFullOverwrite() enabled. The mailbox uses three item buffers - one being
+ * written, one being read and one holding the latest complete value. The writer
+ * never waits and the reader always gets the newest complete value with a single
+ * copy, without any chance of seeing a partly written item.
+ *
+ * write() may be called from an interrupt service routine while read() is
+ * called from the main program if CQ_ISR_SAFE is set in MD_CirQueue.h.
+ */
+class MD_CirMailbox
+{
+public:
+  /**
+   * Class Constructor.
+   *
+   * Instantiate a new instance of the class. The parameter passed is used to
+   * configure the size of the mailbox item.
+   *
+   * \param itmSize   size of the item in bytes.
+   */
+  MD_CirMailbox(uint16_t itmSize) :
+    _itmSize(itmSize), _state(INIT_STATE)
+  {
+    uint16_t size = sizeof(uint8_t) * 3 * _itmSize;
+
+    CQ_PRINT("\nAllocating ", size);
+    CQ_PRINTS("bytes");
+    _itmData = (uint8_t *)malloc(size);
+  }
+
+  /**
+   * Class Destructor.
+   *
+   * Released allocated memory and does the necessary to clean up once the mailbox is
+   * no longer required.
+   */
+  ~MD_CirMailbox()
+  {
+    free(_itmData);
+  }
+
+  /**
+   * Initialize the object.
+   *
+   * Initialize the object data. This needs to be called during setup() to initialize new
+   * data for the class that cannot be done during the object creation.
+   */
+  void begin(void) {};
+
+ /**
+  * Clear the mailbox
+  *
+  * Discards any value that has been written but not yet read.
+  */
+  inline void clear() { CQ_LOCK(); _state &= ~NEW_FLAG; CQ_UNLOCK(); };
+
+ /**
+  * Write a new value into the mailbox
+  *
+  * The item is copied into the free buffer and then published as the latest value,
+  * replacing any value that has not yet been read.
+  *
+  * @param itm    a pointer to data buffer of the item to be saved. Data size must be size specified in the constructor.
+  */
+  void write(uint8_t* itm)
+  {
+    uint8_t s = _state;
+
+    CQ_PRINT("\nWrite @", getBack(s));
+    memcpy(_itmData + (_itmSize * getBack(s)), itm, _itmSize);
+
+    // swap the back and middle buffers and flag new data
+    _state = NEW_FLAG | (getFront(s) << FRONT_SHIFT) | (getBack(s) << MIDDLE_SHIFT) | getMiddle(s);
+  }
+
+ /**
+  * Read the latest value from the mailbox
+  *
+  * Copy the most recently written value into the buffer specified, returning a
+  * pointer to the copied item. If no value has been written since the last read(),
+  * the previous value is copied again and the method returns a NULL pointer.
+  *
+  * @param itm  a pointer to data buffer for the retrieved item to be saved. Data size must be size specified in the constructor.
+  * @return pointer to the memory buffer or NULL if there is no new value
+  */
+  uint8_t *read(uint8_t* itm)
+  {
+    bool fresh;
+    uint8_t front;
+
+    CQ_LOCK();
+    uint8_t s = _state;
+    fresh = (s & NEW_FLAG);
+    if (fresh)  // swap the middle and front buffers and clear the flag
+      s = (getMiddle(s) << FRONT_SHIFT) | (getFront(s) << MIDDLE_SHIFT) | getBack(s);
+    _state = s;
+    CQ_UNLOCK();
+
+    front = getFront(s);
+    CQ_PRINT("\nRead @", front);
+    memcpy(itm, _itmData + (_itmSize * front), _itmSize);
+
+    return(fresh ? itm : NULL);
+  }
+
+ /**
+  * Check if there is a new value in the mailbox
+  *
+  * @return true if a value has been written since the last read(), false otherwise
+  */
+  inline bool isNew(void) { return((_state & NEW_FLAG) != 0); };
+
+private:
+  static const uint8_t NEW_FLAG = 0x80;     ///< set when the middle buffer holds an unread value
+  static const uint8_t FRONT_SHIFT = 4;     ///< bit position of the front (reader) buffer index
+  static const uint8_t MIDDLE_SHIFT = 2;    ///< bit position of the middle (latest) buffer index
+  static const uint8_t INIT_STATE = (2 << FRONT_SHIFT) | (1 << MIDDLE_SHIFT) | 0;  ///< front 2, middle 1, back 0
+
+  inline uint8_t getFront(uint8_t s)  { return((s >> FRONT_SHIFT) & 0x3); };
+  inline uint8_t getMiddle(uint8_t s) { return((s >> MIDDLE_SHIFT) & 0x3); };
+  inline uint8_t getBack(uint8_t s)   { return(s & 0x3); };
+
+  uint16_t  _itmSize;   /// size in bytes for the item
+  uint8_t*  _itmData;   /// pointer to allocated memory buffer for 3 items
+
+  volatile uint8_t _state;  /// buffer indices and new data flag, updated as one byte
+};
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <MD_CirQueue.h>
+
+/**
+ * \file
+ * \brief Header file and class definition for the MD_CirPool fixed block pool
+ */
+
+/**
+ * Fixed block memory pool for the MD_CirQueue library
+ *
+ * Large items can be kept out of the queue by holding them in blocks from a
+ * pool allocated once at startup. The queue then carries only the one byte
+ * handle of each block, keeping it small, while the block memory is recycled
+ * without using the heap after the pool is created.
+ *
+ * The producer allocates a block, fills it and pushes the handle. The consumer
+ * pops the handle, uses the block and releases it back to the pool:
+ *
+ *     MD_CirPool P(8, 64);
+ *     MD_CirQueue Q(8, sizeof(uint8_t));
+ *
+ *     uint8_t h = P.alloc();
+ *     if (h != MD_CirPool::NO_BLOCK) { fill(P.getBlock(h)); Q.push(&h); }
+ *     ...
+ *     if (Q.pop(&h) != NULL) { use(P.getBlock(h)); P.release(h); }
+ *
+ * The free list is threaded through the unused blocks, so there is no extra memory
+ * overhead. alloc() and release() may be used from both an interrupt service
+ * routine and the main program if CQ_ISR_SAFE is set in MD_CirQueue.h. The lock
+ * they take restores the previous interrupt state when released, so interrupts
+ * are not enabled inside the interrupt service routine.
+ */
+class MD_CirPool
+{
+public:
+  static const uint8_t NO_BLOCK = 0xff;   ///< handle returned by alloc() when the pool is empty
+
+  /**
+   * Class Constructor.
+   *
+   * Instantiate a new instance of the class. The parameters passed are used to
+   * configure the quantity and size of the pool blocks.
+   *
+   * \param blkQty    number of blocks in the pool, up to 255.
+   * \param blkSize   size of each block in bytes, at least 1.
+   */
+  MD_CirPool(uint8_t blkQty, uint16_t blkSize) :
+    _blkQty(blkQty == NO_BLOCK ? NO_BLOCK - 1 : blkQty), _blkSize(blkSize == 0 ? 1 : blkSize)
+  {
+    uint16_t size = sizeof(uint8_t) * _blkQty * _blkSize;
+
+    CQ_PRINT("\nAllocating ", size);
+    CQ_PRINTS("bytes");
+    _blkData = (uint8_t *)malloc(size);
+    clear();
+  }
+
+  /**
+   * Class Destructor.
+   *
+   * Released allocated memory and does the necessary to clean up once the pool is
+   * no longer required.
+   */
+  ~MD_CirPool()
+  {
+    free(_blkData);
+  }
+
+  /**
+   * Initialize the object.
+   *
+   * Initialize the object data. This needs to be called during setup() to initialize new
+   * data for the class that cannot be done during the object creation.
+   */
+  void begin(void) {};
+
+ /**
+  * Return all blocks to the pool
+  *
+  * Rebuilds the free list so that all the blocks are available. Any handles
+  * still held by the application become invalid.
+  */
+  void clear(void)
+  {
+    CQ_LOCK();
+    for (uint8_t i = 0; i < _blkQty; i++)
+      *getBlock(i) = (i + 1 < _blkQty) ? i + 1 : NO_BLOCK;
+    _idxFree = (_blkQty == 0) ? NO_BLOCK : 0;
+    _blkFree = _blkQty;
+    CQ_UNLOCK();
+  }
+
+ /**
+  * Allocate a block from the pool
+  *
+  * @return the handle of the allocated block or NO_BLOCK if the pool is empty
+  */
+  uint8_t alloc(void)
+  {
+    uint8_t h;
+
+    CQ_LOCK();
+    h = _idxFree;
+    if (h != NO_BLOCK)
+    {
+      _idxFree = *getBlock(h);
+      _blkFree--;
+    }
+    CQ_UNLOCK();
+
+    CQ_PRINT("\nAlloc @", h);
+
+    return(h);
+  }
+
+ /**
+  * Release a block back to the pool
+  *
+  * The handle must have been returned by alloc() and not already released.
+  *
+  * @param h  the handle of the block to release.
+  */
+  void release(uint8_t h)
+  {
+    if (h >= _blkQty) return;
+
+    CQ_PRINT("\nRelease @", h);
+    CQ_LOCK();
+    *getBlock(h) = _idxFree;
+    _idxFree = h;
+    _blkFree++;
+    CQ_UNLOCK();
+  }
+
+ /**
+  * Get the memory for a block
+  *
+  * @param h  the handle of the block.
+  * @return pointer to the block memory
+  */
+  inline uint8_t *getBlock(uint8_t h) { return(_blkData + (_blkSize * h)); };
+
+ /**
+  * Get the number of free blocks
+  *
+  * @return the number of blocks available to alloc()
+  */
+  inline uint8_t getFree(void) { return(_blkFree); };
+
+ /**
+  * Check if the pool is empty
+  *
+  * @return true if there are no free blocks, false otherwise
+  */
+  inline bool isEmpty(void) { return(_idxFree == NO_BLOCK); };
+
+private:
+  uint8_t   _blkQty;    /// number of blocks in the pool
+  uint16_t  _blkSize;   /// size in bytes for each block
+  uint8_t*  _blkData;   /// pointer to allocated memory buffer
+
+  volatile uint8_t _idxFree;  /// handle of the first free block, NO_BLOCK if none
+  volatile uint8_t _blkFree;  /// number of free blocks
+};
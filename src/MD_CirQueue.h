@@ -37,6 +37,34 @@ License along with this library; if not, write to the Free Software
 Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
 
 \page pageRevisionHistory Revision History
+Oct 2026 version 1.1.0
+- Added popBack() for LIFO access to the newest item
+- Added pushFront() to requeue an item at the head of the queue
+- Added removeIf() and countIf() for predicate based bulk operations
+- Added item sequence numbers to pop() and peek() to detect lost items
+- Added CQ_ISR_SAFE option for an interrupt producer in overwrite mode
+- Added MD_CirMailbox triple buffered latest value mailbox
+- Added MD_CirPool fixed block pool for items referenced by handle
+- Added constructor to use application supplied queue storage
+- Added getStorage() and getStorageSize() to report buffer placement
+- Added setPrefetch() to prefetch upcoming items on cached processors
+- Added peekField() to read one field of any item in the queue
+- Added optional item alignment to the constructors
+- Added MD_CirBitQueue bit packed integer queue
+- Added MD_CirDeltaQueue delta compressed integer queue
+- Added MD_CirReorder sequence number reorder buffer
+- Added read(), ack() and nack() for acknowledged consumption
+- Added seek() and seekTime() to replay items still in the buffer
+- Added beginTx(), pushTx(), commitTx() and abortTx() for all-or-nothing pushes
+- Added pushv() and popv() to gather and scatter item fragments
+- Added MD_CirDelayQueue timing wheel delay queue
+- Added setEventCallback() for queue state changes
+- Added MD_CirQueueSet deficit round robin scheduler for multiple queues
+- Added MD_CirQueueSet ready() and wait() to find a queue with items
+- Added setWatermarks() for high and low occupancy events
+- Added readBatch() for time and size bounded batches of items
+- Added getBatchSize() for batch sizes that adapt to the queue depth
+
 Oct 2020 version 1.0.3
 - Administrative update
 
@@ -57,6 +85,17 @@ Jan 2017 version 1.0
 
 #define CQ_DEBUG 0
 
+/**
+ * Set to 1 to allow push() to be called from an interrupt service routine while
+ * pop() and peek() are called from the main program. The consumer briefly disables
+ * interrupts to read and update the queue indices, but never while copying item
+ * data, so the producer is not held up. If the producer overwrites the item being
+ * copied (setFullOverwrite() enabled), the copy is detected as torn and is retried
+ * with the new oldest item. Other methods that change the queue are not protected
+ * and should only be used while the producer is inactive.
+ */
+#define CQ_ISR_SAFE 0
+
 #if CQ_DEBUG
 #define CQ_PRINTS(s)   { Serial.print(F(s)); }
 #define CQ_PRINT(s, v) { Serial.print(F(s)); Serial.print(v); }
@@ -65,30 +104,203 @@ Jan 2017 version 1.0
 #define CQ_PRINT(s, v)
 #endif
 
+#if defined(__GNUC__)
+#define CQ_PREFETCH_RD(p) { __builtin_prefetch((p), 0); }
+#define CQ_PREFETCH_WR(p) { __builtin_prefetch((p), 1); }
+#else
+#define CQ_PREFETCH_RD(p)
+#define CQ_PREFETCH_WR(p)
+#endif
+
+#if CQ_ISR_SAFE
+/**
+ * Interrupt lock used when CQ_ISR_SAFE is set. Locks may be nested, and releasing
+ * the outermost lock restores the interrupt state from before it was taken, so the
+ * same methods can be called from the main program and from an interrupt service
+ * routine without enabling interrupts inside the routine. On architectures where
+ * the interrupt state cannot be read, interrupts are always enabled on release.
+ */
+#if defined(__AVR__)
+#define CQ_IRQ_STATE_T    uint8_t
+#define CQ_IRQ_SAVE()     (SREG)
+#define CQ_IRQ_RESTORE(s) { SREG = (s); }
+#elif defined(__arm__)
+#define CQ_IRQ_STATE_T    uint32_t
+#define CQ_IRQ_SAVE()     (__get_PRIMASK())
+#define CQ_IRQ_RESTORE(s) { __set_PRIMASK(s); }
+#else
+#define CQ_IRQ_STATE_T    uint8_t
+#define CQ_IRQ_SAVE()     (0)
+#define CQ_IRQ_RESTORE(s) { (void)(s); interrupts(); }
+#endif
+
+typedef struct
+{
+  uint8_t        depth;   ///< number of locks currently taken
+  CQ_IRQ_STATE_T state;   ///< interrupt state from before the outermost lock
+} cqLockState_t;
+
+inline cqLockState_t& cqLockState(void) { static cqLockState_t ls = { 0, 0 }; return(ls); }
+
+inline void cqLock(void)
+{
+  CQ_IRQ_STATE_T s = CQ_IRQ_SAVE();
+
+  noInterrupts();
+  cqLockState_t& ls = cqLockState();
+  if (ls.depth++ == 0) ls.state = s;
+}
+
+inline void cqUnlock(void)
+{
+  cqLockState_t& ls = cqLockState();
+  if (--ls.depth == 0) CQ_IRQ_RESTORE(ls.state);
+}
+
+#define CQ_LOCK()   { cqLock(); }
+#define CQ_UNLOCK() { cqUnlock(); }
+#else
+#define CQ_LOCK()
+#define CQ_UNLOCK()
+#endif
+
 /**
  * Core object for the MD_CirQueue library
  */
 class MD_CirQueue
 {
 public:
+  /**
+   * Item predicate function type
+   *
+   * Used by the bulk operations removeIf() and countIf() to test each item in the
+   * queue. The function is passed a pointer to the item data in the queue buffer
+   * and the user context pointer passed to the bulk operation, and returns true
+   * if the item matches.
+   */
+  typedef bool (*itemPredicate_t)(uint8_t* itm, void* ctx);
+
+  /**
+   * Item time function type
+   *
+   * Used by seekTime() to get the timestamp held in an item. The function is passed
+   * a pointer to the item data in the queue buffer and returns the item time (eg,
+   * a millis() value saved in the item when it was pushed).
+   */
+  typedef uint32_t (*itemTime_t)(uint8_t* itm);
+
+  /**
+   * Item fragment definition
+   *
+   * Used by pushv() and popv() to describe one part of an item held in a separate
+   * memory buffer.
+   */
+  typedef struct
+  {
+    uint8_t*  data;   ///< pointer to the fragment memory buffer
+    uint16_t  len;    ///< length of the fragment in bytes
+  } fragment_t;
+
+  /**
+   * Queue event enumerated type
+   *
+   * Used by the event callback to identify the change in the queue state.
+   */
+  enum event_t
+  {
+    EVT_NOT_EMPTY,  ///< the queue was empty and now has items
+    EVT_HIGH_WATER, ///< the number of items has risen to the high watermark
+    EVT_LOW_WATER,  ///< the number of items has fallen to the low watermark
+  };
+
+  /**
+   * Item alignment enumerated type
+   *
+   * Used by the constructors to specify the alignment of each item in bytes. This
+   * is a separate type so that a number passed as the third constructor parameter
+   * cannot be mistaken for an alignment instead of a buffer pointer.
+   */
+  enum align_t
+  {
+    ALIGN_1 = 1,    ///< items packed one after the other
+    ALIGN_2 = 2,    ///< items aligned to 2 bytes
+    ALIGN_4 = 4,    ///< items aligned to 4 bytes
+    ALIGN_8 = 8,    ///< items aligned to 8 bytes
+    ALIGN_16 = 16,  ///< items aligned to 16 bytes
+    ALIGN_32 = 32,  ///< items aligned to 32 bytes
+    ALIGN_64 = 64,  ///< items aligned to 64 bytes
+  };
+
+  /**
+   * Queue event callback function type
+   *
+   * Called when the queue state changes. The function is passed a pointer to the
+   * queue, the event and the user context pointer given to setEventCallback().
+   * It is called from within the queue method making the change, so it should be
+   * short and must not change the queue.
+   */
+  typedef void (*eventCallback_t)(MD_CirQueue* q, event_t evt, void* ctx);
+
   /**
    * Class Constructor.
    *
    * Instantiate a new instance of the class. The parameters passed are used to
    * configure the quantity and size of queue objects.
    *
+   * Items are normally packed one after the other in memory. If an alignment is
+   * specified, each item is placed at an address that is a multiple of the alignment,
+   * padding the items as needed. This allows items to be accessed directly in the
+   * queue using aligned or vector load and store instructions, at the cost of some
+   * memory.
+   *
    * \param itmQty    number of items allowed in the queue.
    * \param itmSize   size of each item in bytes.
+   * \param itmAlign  alignment of each item, default ALIGN_1.
    */
-  MD_CirQueue(uint8_t itmQty, uint16_t itmSize) :
-    _itmQty(itmQty), _itmSize(itmSize),
-    _itmCount(0), _overwrite(false)
+  MD_CirQueue(uint8_t itmQty, uint16_t itmSize, align_t itmAlign = ALIGN_1) :
+    _itmQty(itmQty), _itmSize(itmSize), _itmStride(getStride(itmSize, itmAlign)),
+    _itmCount(0), _overwrite(false), _seqTake(0), _prefetch(0),
+    _cb(NULL), _cbCtx(NULL), _wmHigh(0), _wmLow(0), _wmAbove(false)
   {
-    uint16_t size = sizeof(uint8_t) * _itmQty * _itmSize;
+    uint8_t align = getAlign(itmAlign);
+    uint16_t size = getStorageSize() + align - 1;
 
     CQ_PRINT("\nAllocating ", size);
     CQ_PRINTS("bytes");
-    _itmData = (uint8_t *)malloc(size);
+    _memAlloc = (uint8_t *)malloc(size);
+
+    // round up the start address to the alignment
+    _itmData = _memAlloc;
+    if (_itmData != NULL)
+      _itmData += (align - ((uintptr_t)_itmData & (align - 1))) & (align - 1);
+    setBatchLimits(1, _itmQty);
+    clear();
+  }
+
+  /**
+   * Class Constructor with application storage.
+   *
+   * Instantiate a new instance of the class using a memory buffer supplied by the
+   * application instead of allocating from the heap. This allows the buffer to be
+   * statically allocated, avoiding heap fragmentation and giving an accurate RAM
+   * usage report at compile time, or to be placed in a specific memory region
+   * (eg, using a linker section attribute).
+   *
+   * If an alignment is specified, the buffer supplied must already be aligned and
+   * each item is padded to a multiple of the alignment.
+   *
+   * \param itmQty    number of items allowed in the queue.
+   * \param itmSize   size of each item in bytes.
+   * \param buf       pointer to a buffer of at least (itmQty * itmSize) bytes, with itmSize rounded up to a multiple of itmAlign. It must remain valid for the life of the queue.
+   * \param itmAlign  alignment of each item, default ALIGN_1.
+   */
+  MD_CirQueue(uint8_t itmQty, uint16_t itmSize, uint8_t* buf, align_t itmAlign = ALIGN_1) :
+    _itmQty(itmQty), _itmSize(itmSize), _itmStride(getStride(itmSize, itmAlign)),
+    _itmData(buf), _memAlloc(NULL), _itmCount(0), _overwrite(false), _seqTake(0), _prefetch(0),
+    _cb(NULL), _cbCtx(NULL), _wmHigh(0), _wmLow(0), _wmAbove(false)
+  {
+    CQ_PRINTS("\nUsing supplied buffer");
+    setBatchLimits(1, _itmQty);
     clear();
   }
 
@@ -100,7 +312,7 @@ public:
    */
   ~MD_CirQueue()
   {
-    free(_itmData);
+    free(_memAlloc);
   }
 
   /**
@@ -115,9 +327,11 @@ public:
   * Clear contents of buffer
   *
   * Clears the buffer by resetting the head and tail pointers. Does not zero out delete
-  * data in the buffer.
+  * data in the buffer. Sequence numbers continue from the last item cleared.
+  * Items already popped can no longer be returned to using seek(). Any open
+  * transaction is aborted.
   */
-   inline void clear() { _idxPut = _idxTake = _itmCount = 0; };
+   inline void clear() { _seqTake += _itmCount; _idxPut = _idxTake = _itmCount = _readCount = _histCount = _txCount = _batchLeft = 0; _txOpen = false; checkLevel(); };
 
  /**
   * Push an item into the queue
@@ -126,18 +340,48 @@ public:
   * to the calling program, in FIFO order, using pop().
   * If the buffer is already full before the push(), the behavior will depend on the
   * the setting controlled by the setFullOverwrite() method.
+  * The push always fails while a transaction is open (see beginTx()).
   *
   * @param itm    a pointer to data buffer of the item to be saved. Data size must be size specified in the constructor.
   * @return true  if the item was successfully placed in the queue, false otherwise
   */
   bool push(uint8_t* itm)
+  {
+    fragment_t f = { itm, _itmSize };
+
+    return(pushv(&f, 1));
+  }
+
+ /**
+  * Push an item made of fragments into the queue
+  *
+  * As for push(), but the item is assembled in the queue from fragments held in
+  * separate memory buffers (eg, a header and a payload), in the order given. This
+  * avoids first having to copy the fragments into a temporary item buffer. If the
+  * fragments are shorter than the item size specified in the constructor, the
+  * remainder of the item is undefined.
+  *
+  * @param frag   an array of fragments making up the item.
+  * @param n      the number of fragments in the array.
+  * @return true  if the item was successfully placed in the queue, false otherwise or if the fragments are larger than the item size
+  */
+  bool pushv(const fragment_t* frag, uint8_t n)
     {
+  uint16_t len = 0;
+
+  for (uint8_t i = 0; i < n; i++)
+  {
+    if (frag[i].len > _itmSize - len) return(false);
+    len += frag[i].len;
+  }
+
+  if (_txOpen) return(false);
   if (isFull())
   {
     if (_overwrite)
     {
     CQ_PRINTS("\nOverwriting Q");
-    pop(_itmData + (_idxTake * _itmSize));  // pop it into itself ...
+    dropHead();
     }
     else
       return(false);
@@ -145,14 +389,133 @@ public:
 
     // Save item and adjust the tail pointer
     CQ_PRINT("\nPush @", _idxPut);
-    memcpy(_itmData + (_itmSize * _idxPut), itm, _itmSize);
+    if (_prefetch != 0) CQ_PREFETCH_WR(getItem(_idxPut, _prefetch));
+    uint8_t* p = _itmData + (_itmStride * _idxPut);
+    for (uint8_t i = 0; i < n; i++)
+    {
+      memcpy(p, frag[i].data, frag[i].len);
+      p += frag[i].len;
+    }
     _idxPut++;
     _itmCount++;
     if (_idxPut == _itmQty) _idxPut = 0;
+    if (_histCount > _itmQty - _itmCount) _histCount = _itmQty - _itmCount;
+    if (_itmCount - _readCount == 1) firstUnread();
+    if (_itmCount == 1) notify(EVT_NOT_EMPTY);
+    checkLevel();
+
+    return(true);
+  }
+
+ /**
+  * Push an item into the front of the queue
+  *
+  * Place the item passed at the head of the queue, so that it will be the next
+  * item returned by pop(). This is useful to requeue an item that could not be
+  * processed (eg, after a failed send) without disturbing the order of the rest
+  * of the queue.
+  * Unlike push(), this method will always fail if the queue is full, irrespective
+  * of the setFullOverwrite() setting. Any items handed out by read() and not yet
+  * acknowledged will be handed out again, as for nack().
+  *
+  * @param itm    a pointer to data buffer of the item to be saved. Data size must be size specified in the constructor.
+  * @return true  if the item was successfully placed in the queue, false otherwise
+  */
+  bool pushFront(uint8_t* itm)
+  {
+    if (_itmCount + _txCount >= _itmQty) return(false);
+
+    bool noUnread = (_itmCount == _readCount);
+
+    // Move the head pointer back, wrapping around to the end if needed
+    if (_idxTake == 0) _idxTake = _itmQty;
+    _idxTake--;
+    _itmCount++;
+    _seqTake--;
+    _readCount = 0;
+    if (_histCount != 0) _histCount--;
+    if (noUnread) firstUnread();
+
+    // Save item at the new head
+    CQ_PRINT("\nPushFront @", _idxTake);
+    memcpy(_itmData + (_itmStride * _idxTake), itm, _itmSize);
+    if (_itmCount == 1) notify(EVT_NOT_EMPTY);
+    checkLevel();
+
+    return(true);
+  }
+
+ /**
+  * Begin a transaction
+  *
+  * Items that must be queued together, such as the parts of a message spread over
+  * several items, are pushed in a transaction. The items are saved into the free
+  * space in the queue using pushTx() but do not become part of the queue until
+  * commitTx() adds them all at once. If the message cannot be completed, abortTx()
+  * discards them, so a partial message is never queued.
+  * While a transaction is open, push(), popBack() and removeIf() will fail.
+  * Beginning a transaction while one is already open discards the items pushed in it.
+  */
+  inline void beginTx(void) { _txOpen = true; _txCount = 0; };
+
+ /**
+  * Push an item in a transaction
+  *
+  * Save the item passed after the end of the queue and any items already pushed
+  * in the transaction. The item is not available to pop() until commitTx() is
+  * called. Items are never overwritten to make space, irrespective of the
+  * setFullOverwrite() setting.
+  *
+  * @param itm    a pointer to data buffer of the item to be saved. Data size must be size specified in the constructor.
+  * @return true  if the item was saved, false if there is no transaction open or no space in the queue
+  */
+  bool pushTx(uint8_t* itm)
+  {
+    if (!_txOpen || _itmCount + _txCount >= _itmQty) return(false);
+
+    CQ_PRINT("\nPushTx @", _txCount);
+    memcpy(getItem(_idxPut, _txCount), itm, _itmSize);
+    _txCount++;
+    if (_histCount > _itmQty - _itmCount - _txCount) _histCount = _itmQty - _itmCount - _txCount;
+
+    return(true);
+  }
+
+ /**
+  * Commit a transaction
+  *
+  * Adds all the items pushed in the transaction to the end of the queue in one
+  * step and closes the transaction.
+  *
+  * @return true if the transaction was committed, false if there is no transaction open
+  */
+  bool commitTx(void)
+  {
+    if (!_txOpen) return(false);
+
+    CQ_PRINT("\nCommitTx ", _txCount);
+    CQ_LOCK();
+    bool wasEmpty = isEmpty();
+    bool noUnread = (_itmCount == _readCount);
+    _idxPut = getItemIndex(_idxPut, _txCount);
+    _itmCount += _txCount;
+    CQ_UNLOCK();
+    if (noUnread && _txCount != 0) firstUnread();
+    if (wasEmpty && _txCount != 0) notify(EVT_NOT_EMPTY);
+    checkLevel();
+    _txCount = 0;
+    _txOpen = false;
 
     return(true);
   }
 
+ /**
+  * Abort a transaction
+  *
+  * Discards all the items pushed in the transaction and closes the transaction.
+  */
+  inline void abortTx(void) { _txOpen = false; _txCount = 0; };
+
  /**
   * Pop an item from the queue
   *
@@ -160,23 +523,117 @@ public:
   * returning a pointer to the copied item. If no items are available (queue is
   * empty), then no data is copied and the method returns a NULL pointer.
   *
+  * Every item pushed is given a sequence number, one more than the item before it.
+  * If requested, the sequence number of the popped item is also returned. When
+  * setFullOverwrite() is enabled, a gap in the sequence numbers of consecutive
+  * pop() calls is the number of items that were overwritten in between.
+  *
   * @param itm  a pointer to data buffer for the retrieved item to be saved. Data size must be size specified in the constructor.
+  * @param seq  optional pointer to a variable to receive the item sequence number.
   * @return pointer to the memory buffer or NULL if the queue is empty
   */
-  uint8_t *pop(uint8_t* itm)
+  uint8_t *pop(uint8_t* itm, uint32_t* seq = NULL)
+  {
+    fragment_t f = { itm, _itmSize };
+
+    return(popv(&f, 1, seq) ? itm : NULL);
+  }
+
+ /**
+  * Pop an item from the queue into fragments
+  *
+  * As for pop(), but the item is split into fragments copied to separate memory
+  * buffers (eg, a header and a payload), in the order given. This avoids first
+  * having to copy the item into a temporary buffer. If the fragments are shorter
+  * than the item size specified in the constructor, the remainder of the item is
+  * not copied.
+  *
+  * @param frag an array of fragments to receive the item.
+  * @param n    the number of fragments in the array.
+  * @param seq  optional pointer to a variable to receive the item sequence number.
+  * @return true if an item was popped, false if the queue is empty or the fragments are larger than the item size
+  */
+  bool popv(const fragment_t* frag, uint8_t n, uint32_t* seq = NULL)
+  {
+    uint16_t len = 0;
+
+    for (uint8_t i = 0; i < n; i++)
     {
-    if (isEmpty()) return(NULL);
+      if (frag[i].len > _itmSize - len) return(false);
+      len += frag[i].len;
+    }
 
-    // Copy data from the buffer
-    CQ_PRINT("\nPop @", _idxTake);
-    memcpy(itm, _itmData + (_itmSize * _idxTake), _itmSize);
-    _idxTake++;
+    uint32_t s;
+    bool torn;
+
+    do
+    {
+      uint8_t idx;
+
+      CQ_LOCK();
+      if (isEmpty())
+      {
+        CQ_UNLOCK();
+        return(false);
+      }
+      s = _seqTake;
+      idx = _idxTake;
+      CQ_UNLOCK();
+
+      // Copy data from the buffer
+      CQ_PRINT("\nPop @", idx);
+      if (_prefetch != 0) CQ_PREFETCH_RD(getItem(idx, _prefetch));
+      uint8_t* p = _itmData + (_itmStride * idx);
+      for (uint8_t i = 0; i < n; i++)
+      {
+        memcpy(frag[i].data, p, frag[i].len);
+        p += frag[i].len;
+      }
+
+      // Only remove the item if it was not overwritten during the copy
+      CQ_LOCK();
+      torn = (s != _seqTake);
+      if (!torn) dropHead();
+      CQ_UNLOCK();
+    } while (torn);
+
+    if (seq != NULL) *seq = s;
+    checkLevel();
+
+    return(true);
+  }
+
+ /**
+  * Pop the newest item from the queue
+  *
+  * Return the last item pushed into the queue, copied into the buffer specified,
+  * returning a pointer to the copied item. If no items are available (queue is
+  * empty), then no data is copied and the method returns a NULL pointer.
+  *
+  * Used together with push() and pop(), the queue can serve as a simple work
+  * deque - the owner adds and removes work at the tail (LIFO) using push() and
+  * popBack(), while other consumers take the oldest work from the head (FIFO)
+  * using pop().
+  *
+  * @param itm  a pointer to data buffer for the retrieved item to be saved. Data size must be size specified in the constructor.
+  * @return pointer to the memory buffer or NULL if the queue is empty or a transaction is open
+  */
+  uint8_t *popBack(uint8_t* itm)
+  {
+    if (isEmpty() || _txOpen) return(NULL);
+
+    // Move the tail pointer back, wrapping around to the end if needed
+    if (_idxPut == 0) _idxPut = _itmQty;
+    _idxPut--;
     _itmCount--;
+    if (_readCount > _itmCount) _readCount = _itmCount;
 
-    // If head has reached last item, wrap it back around to the start
-    if (_idxTake == _itmQty) _idxTake = 0;
+    // Copy data from the buffer
+    CQ_PRINT("\nPopBack @", _idxPut);
+    memcpy(itm, _itmData + (_itmStride * _idxPut), _itmSize);
+    checkLevel();
 
-    return (itm);
+    return(itm);
   }
 
  /**
@@ -189,19 +646,445 @@ public:
    * processing the queue.
    *
    * @param itm a pointer to data buffer for the copied item to be saved. Data size must be size specified in the constructor.
+   * @param seq optional pointer to a variable to receive the item sequence number.
    * @return pointer to the memory buffer or NULL if the queue is empty
    */
-   uint8_t *peek(uint8_t* itm)
+   uint8_t *peek(uint8_t* itm, uint32_t* seq = NULL)
    {
-     if (isEmpty()) return(NULL);
+     uint32_t s;
+     bool torn;
+
+     do
+     {
+       uint8_t idx;
 
-     // Copy data from the buffer
-     CQ_PRINT("\nPeek @", _idxTake);
-     memcpy(itm, _itmData + (_itmSize * _idxTake), _itmSize);
+       CQ_LOCK();
+       if (isEmpty())
+       {
+         CQ_UNLOCK();
+         return(NULL);
+       }
+       s = _seqTake;
+       idx = _idxTake;
+       CQ_UNLOCK();
+
+       // Copy data from the buffer
+       CQ_PRINT("\nPeek @", idx);
+       memcpy(itm, _itmData + (_itmStride * idx), _itmSize);
+
+       // Check the item was not overwritten during the copy
+       CQ_LOCK();
+       torn = (s != _seqTake);
+       CQ_UNLOCK();
+     } while (torn);
+
+     if (seq != NULL) *seq = s;
 
      return (itm);
    }
 
+ /**
+  * Peek at a field of an item in the queue
+  *
+  * Copy part of the item n places from the head of the queue (0 is the next item
+  * returned by pop()) into the buffer specified, without removing it. Where items
+  * are records with several fields, this allows one field to be scanned across all
+  * the items in the queue without copying the whole of each item.
+  *
+  * @param n      the position of the item in the queue, 0 being the oldest.
+  * @param offset the offset in bytes of the field in the item.
+  * @param len    the size in bytes of the field.
+  * @param buf    a pointer to data buffer for the copied field to be saved.
+  * @return pointer to the memory buffer or NULL if there is no such item or field
+  */
+  uint8_t *peekField(uint8_t n, uint16_t offset, uint16_t len, uint8_t* buf)
+  {
+    uint32_t s;
+    bool torn;
+
+    if (offset >= _itmSize || len > _itmSize - offset) return(NULL);
+
+    do
+    {
+      uint8_t idx;
+
+      CQ_LOCK();
+      if (n >= _itmCount)
+      {
+        CQ_UNLOCK();
+        return(NULL);
+      }
+      s = _seqTake;
+      idx = _idxTake;
+      CQ_UNLOCK();
+
+      // Copy the field from the buffer
+      CQ_PRINT("\nPeekField @", n);
+      memcpy(buf, getItem(idx, n) + offset, len);
+
+      // Check the item was not overwritten during the copy
+      CQ_LOCK();
+      torn = (s != _seqTake);
+      CQ_UNLOCK();
+    } while (torn);
+
+    return(buf);
+  }
+
+ /**
+  * Read the next item from the queue without removing it
+  *
+  * Return the next item not yet handed out by read(), copied into the buffer specified,
+  * returning a pointer to the copied item. The item stays in the queue, and
+  * continues to take up space, until it is acknowledged with ack(). If the item
+  * cannot be processed, nack() makes all the unacknowledged items available to
+  * read() again. This gives at-least-once delivery of items without having to
+  * copy them elsewhere for retries.
+  *
+  * pop() removes the oldest item whether it has been read() or not.
+  *
+  * @param itm  a pointer to data buffer for the retrieved item to be saved. Data size must be size specified in the constructor.
+  * @param seq  optional pointer to a variable to receive the item sequence number.
+  * @return pointer to the memory buffer or NULL if there are no more items to read
+  */
+  uint8_t *read(uint8_t* itm, uint32_t* seq = NULL)
+  {
+    uint32_t s;
+    uint8_t n;
+    bool torn;
+
+    do
+    {
+      uint8_t idx;
+
+      CQ_LOCK();
+      if (_readCount >= _itmCount)
+      {
+        CQ_UNLOCK();
+        return(NULL);
+      }
+      s = _seqTake;
+      idx = _idxTake;
+      n = _readCount;
+      CQ_UNLOCK();
+
+      // Copy data from the buffer
+      CQ_PRINT("\nRead @", n);
+      memcpy(itm, getItem(idx, n), _itmSize);
+
+      // Only hand out the item if nothing was overwritten during the copy
+      CQ_LOCK();
+      torn = (s != _seqTake);
+      if (!torn) _readCount++;
+      CQ_UNLOCK();
+    } while (torn);
+
+    if (seq != NULL) *seq = s + n;
+
+    return(itm);
+  }
+
+ /**
+  * Read a batch of items from the queue without copying them
+  *
+  * Waits for a batch of items to build up in the queue, so that a consumer that
+  * works best with large batches is not given items one at a time. A batch is
+  * returned as soon as either maxItems are available or the oldest item has been
+  * waiting for maxWait milliseconds, whichever comes first. Otherwise the method
+  * returns 0 and should be called again later.
+  *
+  * The items are not copied. The pointer returned points to the first item in the
+  * queue buffer, with the following items getItemStride() bytes apart. As the queue
+  * wraps around at the end of the buffer, fewer items than are available may be
+  * returned and the rest of the batch is returned by the next call without waiting. The items are handed out
+  * as for read() and must be released using ack() once they have been processed.
+  *
+  * The wait time is measured from when an item last became available to read with
+  * no other items waiting to be read. Items left after a batch are treated as having
+  * waited as long as the oldest item in it.
+  *
+  * As the items are not copied, an overwriting push (setFullOverwrite() enabled) can
+  * overwrite them while they are being processed. Unlike read(), this is not detected,
+  * so readBatch() should not be used with an overwriting interrupt producer (CQ_ISR_SAFE).
+  *
+  * @param itm      a pointer to a variable to receive the pointer to the first item.
+  * @param maxItems the number of items that make a full batch.
+  * @param maxWait  the longest time in milliseconds to wait for a full batch.
+  * @return the number of items in the batch, 0 if no batch is ready
+  */
+  uint8_t readBatch(uint8_t** itm, uint8_t maxItems, uint32_t maxWait)
+  {
+    uint32_t now = millis();
+    uint8_t n, idx;
+    bool ready;
+
+    // the items are found and handed out in one step, so an interrupt producer
+    // cannot drop the head of the queue in between
+    CQ_LOCK();
+    n = _itmCount - _readCount;
+    idx = getItemIndex(_idxTake, _readCount);
+    if (_batchLeft > n) _batchLeft = n;   // items removed since the last call
+    ready = (n != 0 && (_batchLeft != 0 || n >= maxItems || now - _tsOldest >= maxWait));
+    if (ready)
+    {
+      // start a new batch, or finish one cut short at the end of the buffer
+      if (_batchLeft == 0) _batchLeft = (n > maxItems ? maxItems : n);
+
+      // limit to the items that are contiguous in the buffer
+      n = (_batchLeft > maxItems ? maxItems : _batchLeft);
+      if (n > _itmQty - idx) n = _itmQty - idx;
+      _batchLeft -= n;
+      _readCount += n;
+    }
+    CQ_UNLOCK();
+
+    if (!ready) return(0);
+
+    CQ_PRINT("\nReadBatch ", n);
+    *itm = _itmData + (_itmStride * idx);
+
+    return(n);
+  }
+
+ /**
+  * Set the adaptive batch size limits
+  *
+  * Sets the range and rate of change for the batch size suggested by getBatchSize().
+  *
+  * @param minSize  the smallest batch size, at least 1.
+  * @param maxSize  the largest batch size.
+  * @param step     the amount the batch size grows each time the queue is deeper than the batch size, default 1.
+  */
+  void setBatchLimits(uint8_t minSize, uint8_t maxSize, uint8_t step = 1)
+  {
+    _batchMin = (minSize == 0 ? 1 : minSize);
+    _batchMax = (maxSize < _batchMin ? _batchMin : maxSize);
+    _batchStep = (step == 0 ? 1 : step);
+    _batchSize = _batchMin;
+  }
+
+ /**
+  * Get a batch size suited to the queue depth
+  *
+  * Returns a suggested number of items for the consumer to process at once, for
+  * example as the maxItems for readBatch(). Each time it is called the suggestion
+  * is adjusted for the current number of items in the queue - it grows by a fixed
+  * step while the queue is deeper than the batch size and halves when the queue
+  * falls below half the batch size. This gives small batches and low latency when
+  * the queue is lightly loaded, and large batches for throughput as it fills.
+  *
+  * @return the suggested batch size, within the limits set by setBatchLimits()
+  */
+  uint8_t getBatchSize(void)
+  {
+    uint8_t n = _itmCount;
+
+    if (n > _batchSize)
+      _batchSize = (_batchMax - _batchSize > _batchStep) ? _batchSize + _batchStep : _batchMax;
+    else if (n < _batchSize / 2)
+      _batchSize = (_batchSize / 2 > _batchMin) ? _batchSize / 2 : _batchMin;
+
+    CQ_PRINT("\nBatch size ", _batchSize);
+
+    return(_batchSize);
+  }
+
+ /**
+  * Acknowledge items handed out by read()
+  *
+  * Removes the oldest n items handed out by read() from the queue, freeing their
+  * space for push().
+  *
+  * @param n  the number of items to acknowledge, default 1.
+  * @return the number of items removed, which may be less than n if fewer items were read
+  */
+  uint8_t ack(uint8_t n = 1)
+  {
+    CQ_LOCK();
+    if (n > _readCount) n = _readCount;
+    for (uint8_t i = 0; i < n; i++)
+      dropHead();
+    CQ_UNLOCK();
+
+    CQ_PRINT("\nAck ", n);
+    checkLevel();
+
+    return(n);
+  }
+
+ /**
+  * Return unacknowledged items for redelivery
+  *
+  * All the items handed out by read() and not yet acknowledged will be returned
+  * again, in the same order, by the following calls to read().
+  */
+  inline void nack(void) { CQ_LOCK(); _readCount = 0; CQ_UNLOCK(); };
+
+ /**
+  * Get the number of unacknowledged items
+  *
+  * @return the number of items handed out by read() and not yet acknowledged
+  */
+  inline uint8_t getReadCount(void) { return(_readCount); };
+
+ /**
+  * Move the head of the queue to a sequence number
+  *
+  * Items removed from the head of the queue remain in the buffer until their space
+  * is used by later pushes. This method moves the head of the queue back to one
+  * of these items, so that it and the items after it are returned again by pop().
+  * The head can also be moved forward, discarding the items in between.
+  * Any items handed out by read() and not yet acknowledged will be handed out
+  * again, as for nack().
+  *
+  * @param seq  the sequence number of the item to be at the head of the queue.
+  * @return true if the head of the queue was moved, false if the item is no longer in the buffer
+  */
+  bool seek(uint32_t seq)
+  {
+    uint32_t back = _seqTake - seq;
+    uint32_t fwd = seq - _seqTake;
+    bool noUnread = (_itmCount == _readCount);
+
+    if (back <= _histCount)
+    {
+      CQ_PRINT("\nSeek back ", back);
+      bool wasEmpty = isEmpty();
+      _idxTake = getItemIndex(_idxTake, _itmQty - back);
+      _itmCount += back;
+      _histCount -= back;
+      _seqTake -= back;
+      if (wasEmpty && back != 0) notify(EVT_NOT_EMPTY);
+    }
+    else if (fwd <= _itmCount)
+    {
+      CQ_PRINT("\nSeek forward ", fwd);
+      for (uint8_t i = 0; i < fwd; i++)
+        dropHead();
+    }
+    else
+      return(false);
+
+    _readCount = 0;
+    if (noUnread && _itmCount != 0) firstUnread();
+    checkLevel();
+
+    return(true);
+  }
+
+ /**
+  * Move the head of the queue to a point in time
+  *
+  * Moves the head of the queue, as for seek(), to the oldest item in the buffer
+  * with a time on or after the time specified. The item times are obtained using
+  * the function supplied and must be in increasing order through the queue, as they
+  * are found with a binary search. Times are compared allowing for millis() rollover.
+  * This can be used, for example, to replay the last few seconds of data before an
+  * event.
+  *
+  * @param t      the time to be searched for.
+  * @param timeOf a function returning the time for an item.
+  * @return true if the head of the queue was moved, false if there is no item at or after the time
+  */
+  bool seekTime(uint32_t t, itemTime_t timeOf)
+  {
+    uint8_t idxFirst = getItemIndex(_idxTake, _itmQty - _histCount);
+    uint16_t lo = 0;
+    uint16_t hi = _histCount + _itmCount;
+
+    // find the first position with time >= t
+    while (lo < hi)
+    {
+      uint16_t mid = (lo + hi) / 2;
+
+      if ((int32_t)(timeOf(_itmData + (_itmStride * getItemIndex(idxFirst, mid))) - t) < 0)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+    if (lo == _histCount + _itmCount) return(false);
+
+    return(seek(_seqTake - _histCount + lo));
+  }
+
+ /**
+  * Get the number of items that can be returned to
+  *
+  * @return the number of items before the head of the queue still in the buffer
+  */
+  inline uint8_t getHistoryCount(void) { return(_histCount); };
+
+ /**
+  * Remove all matching items from the queue
+  *
+  * Every item in the queue is tested with the predicate function and those items
+  * for which it returns true are removed. The remaining items are compacted in
+  * place towards the head of the queue in a single pass, preserving their FIFO order.
+  * The remaining items are renumbered so that sequence numbers stay consecutive.
+  * Any items handed out by read() and not yet acknowledged will be handed out
+  * again, as for nack().
+  *
+  * @param pred a predicate function returning true for items to be removed.
+  * @param ctx  a user context pointer passed through to the predicate function.
+  * @return the number of items removed from the queue
+  */
+  uint8_t removeIf(itemPredicate_t pred, void* ctx = NULL)
+  {
+    uint8_t idxSrc = _idxTake;
+    uint8_t idxDst = _idxTake;
+    uint8_t kept = 0;
+
+    if (_txOpen) return(0);
+
+    for (uint8_t i = 0; i < _itmCount; i++)
+    {
+      if (!pred(_itmData + (_itmStride * idxSrc), ctx))
+      {
+        // keep this one, moving it down if there is a gap
+        if (idxDst != idxSrc)
+          memcpy(_itmData + (_itmStride * idxDst), _itmData + (_itmStride * idxSrc), _itmSize);
+        kept++;
+        if (++idxDst == _itmQty) idxDst = 0;
+      }
+      if (++idxSrc == _itmQty) idxSrc = 0;
+    }
+
+    uint8_t removed = _itmCount - kept;
+
+    CQ_PRINT("\nRemoved ", removed);
+    _itmCount = kept;
+    _idxPut = idxDst;
+    _readCount = 0;
+    checkLevel();
+
+    return(removed);
+  }
+
+ /**
+  * Count matching items in the queue
+  *
+  * Every item in the queue is tested with the predicate function and the number
+  * of items for which it returns true is returned. The queue is not changed.
+  *
+  * @param pred a predicate function returning true for items to be counted.
+  * @param ctx  a user context pointer passed through to the predicate function.
+  * @return the number of matching items in the queue
+  */
+  uint8_t countIf(itemPredicate_t pred, void* ctx = NULL)
+  {
+    uint8_t idx = _idxTake;
+    uint8_t count = 0;
+
+    for (uint8_t i = 0; i < _itmCount; i++)
+    {
+      if (pred(_itmData + (_itmStride * idx), ctx)) count++;
+      if (++idx == _itmQty) idx = 0;
+    }
+
+    return(count);
+  }
+
  /**
   * Set queue full behavior
   *
@@ -213,6 +1096,80 @@ public:
   */
   inline void setFullOverwrite(bool b) { _overwrite = b; };
 
+ /**
+  * Set the prefetch distance
+  *
+  * On processors with a data cache, items larger than a cache line can cause the
+  * processor to stall waiting for the item memory to be loaded. When the prefetch
+  * distance is set, pop() asks the processor to start loading the item that many
+  * places ahead in the queue and push() does the same for the slot it will write.
+  * This has no effect on processors without a data cache. Default is 0 (no prefetch).
+  *
+  * @param d  the number of items ahead to prefetch, 0 to disable
+  */
+  inline void setPrefetch(uint8_t d) { _prefetch = (_itmQty == 0) ? 0 : d % _itmQty; };
+
+ /**
+  * Set the queue event callback
+  *
+  * The callback function is called when the queue changes state, as described by
+  * event_t. Only one callback can be set for a queue and it is replaced by each
+  * call to this method. MD_CirQueueSet uses the callback of its member queues.
+  *
+  * @param cb   the callback function, NULL to disable.
+  * @param ctx  a user context pointer passed through to the callback function.
+  */
+  inline void setEventCallback(eventCallback_t cb, void* ctx = NULL) { _cb = cb; _cbCtx = ctx; };
+
+ /**
+  * Get the size of the queue items
+  *
+  * @return the size of each item in bytes, as specified in the constructor
+  */
+  inline uint16_t getItemSize(void) { return(_itmSize); };
+
+ /**
+  * Get the distance between items in the queue buffer
+  *
+  * @return the item size rounded up to the alignment specified in the constructor
+  */
+  inline uint16_t getItemStride(void) { return(_itmStride); };
+
+ /**
+  * Set the queue watermarks
+  *
+  * When the number of items in the queue rises to the high watermark, the
+  * EVT_HIGH_WATER event is sent to the event callback. The EVT_LOW_WATER event
+  * is sent when the number of items then falls back to the low watermark. Each
+  * event is sent once for each crossing, so a producer can be slowed down well
+  * before the queue is full without reacting to every push() and pop() in between.
+  * The current state can also be read at any time using isHighWater().
+  *
+  * @param high the high watermark in items, 0 to disable.
+  * @param low  the low watermark in items, less than the high watermark.
+  */
+  void setWatermarks(uint8_t high, uint8_t low)
+  {
+    _wmHigh = high;
+    _wmLow = (low < high || high == 0) ? low : high - 1;
+    _wmAbove = false;
+    checkLevel();
+  }
+
+ /**
+  * Check if the queue is above the high watermark
+  *
+  * @return true if the queue has reached the high watermark and not yet fallen to the low watermark, false otherwise
+  */
+  inline bool isHighWater(void) { return(_wmAbove); };
+
+ /**
+  * Get the number of items in the queue
+  *
+  * @return the number of items in the queue
+  */
+  inline uint8_t getCount(void) { return(_itmCount); };
+
  /**
   * Check if the buffer is empty
   *
@@ -227,13 +1184,136 @@ public:
   */
   inline bool isFull() { return (_itmCount != 0 && _itmCount == _itmQty); };
 
+ /**
+  * Get the queue storage buffer
+  *
+  * Returns the address of the memory used to hold the queue items. On processors
+  * with more than one memory region (eg, internal and external RAM, or tightly
+  * coupled memory) this allows the application to check where the queue storage
+  * was placed. Use the constructor with an application buffer to choose the region.
+  *
+  * @return pointer to the queue storage, NULL if the allocation failed
+  */
+  inline uint8_t *getStorage(void) { return(_itmData); };
+
+ /**
+  * Get the size of the queue storage buffer
+  *
+  * @return the size of the queue storage in bytes
+  */
+  inline uint16_t getStorageSize(void) { return(sizeof(uint8_t) * _itmQty * _itmStride); };
+
 private:
+ /**
+  * Call the event callback, if there is one.
+  */
+  inline void notify(event_t evt) { if (_cb != NULL) _cb(this, evt, _cbCtx); };
+
+ /**
+  * Record items becoming available to read when there were none, which starts
+  * the readBatch() wait and ends any batch it had not finished returning.
+  */
+  inline void firstUnread(void) { _tsOldest = millis(); _batchLeft = 0; };
+
+ /**
+  * Check for the number of items crossing a watermark. The crossing is found and
+  * recorded under the lock, so each crossing is notified only once even if an
+  * interrupt producer also checks, and the callback is made after unlocking.
+  */
+  inline void checkLevel(void)
+  {
+    if (_wmHigh == 0) return;
+
+    bool high = false, low = false;
+
+    CQ_LOCK();
+    if (!_wmAbove && _itmCount >= _wmHigh)
+      _wmAbove = high = true;
+    else if (_wmAbove && _itmCount <= _wmLow)
+    {
+      _wmAbove = false;
+      low = true;
+    }
+    CQ_UNLOCK();
+
+    if (high) notify(EVT_HIGH_WATER);
+    if (low) notify(EVT_LOW_WATER);
+  }
+
+ /**
+  * Round the alignment up to a power of 2 no larger than 64.
+  */
+  static uint8_t getAlign(uint8_t align)
+  {
+    uint8_t a = 1;
+
+    while (a < align && a < 64) a <<= 1;
+    return(a);
+  }
+
+ /**
+  * Round the item size up to a multiple of the alignment.
+  */
+  static uint16_t getStride(uint16_t size, uint8_t align)
+  {
+    uint8_t a = getAlign(align);
+
+    return((size + a - 1) & ~(uint16_t)(a - 1));
+  }
+
+ /**
+  * Get the address of the item a number of places ahead of an array index.
+  */
+  inline uint8_t *getItem(uint8_t idx, uint8_t ahead) { return(_itmData + (_itmStride * getItemIndex(idx, ahead))); }
+
+ /**
+  * Get the array index a number of places ahead of an array index.
+  */
+  inline uint8_t getItemIndex(uint8_t idx, uint16_t ahead)
+  {
+    uint16_t i = idx + ahead;
+
+    if (i >= _itmQty) i -= _itmQty;
+    return(i);
+  }
+
+ /**
+  * Remove the item at the head of the queue without copying it.
+  */
+  inline void dropHead(void)
+  {
+    if (++_idxTake == _itmQty) _idxTake = 0;
+    _itmCount--;
+    _seqTake++;
+    if (_readCount != 0) _readCount--;
+    _histCount++;
+  }
+
   uint8_t   _itmQty;    /// number of items in the queue
   uint16_t  _itmSize;   /// size in bytes for each item
-  uint8_t*  _itmData;   /// pointer to allocated memory buffer
+  uint16_t  _itmStride; /// distance in bytes between items, _itmSize rounded up to the alignment
+  uint8_t*  _itmData;   /// pointer to aligned memory buffer
+  uint8_t*  _memAlloc;  /// pointer to memory allocated by the class, NULL if supplied by the application
 
-  uint8_t   _itmCount;  /// number of items in the queue
-  uint8_t   _idxPut;    /// array index where the next push will occur
-  uint8_t   _idxTake;   /// array index where next pop will occur
+  volatile uint8_t  _itmCount;  /// number of items in the queue
+  volatile uint8_t  _idxPut;    /// array index where the next push will occur
+  volatile uint8_t  _idxTake;   /// array index where next pop will occur
+  volatile uint8_t  _readCount; /// number of items from _idxTake handed out by read() and not acknowledged
+  volatile uint8_t  _histCount; /// number of popped items before _idxTake not yet overwritten
+  uint8_t   _txCount;   /// number of items pushed in the open transaction
+  bool      _txOpen;    /// true when a transaction is open
   bool      _overwrite; /// when true, overwrite oldest object if push() and isFull()
+  volatile uint32_t _seqTake;   /// sequence number of the item at _idxTake
+  uint8_t   _prefetch;  /// number of items ahead to prefetch, 0 for none
+  eventCallback_t _cb;  /// event callback function, NULL for none
+  void*     _cbCtx;     /// user context pointer for the event callback
+  uint8_t   _wmHigh;    /// high watermark in items, 0 when not used
+  uint8_t   _wmLow;     /// low watermark in items
+  volatile bool _wmAbove; /// true when the high watermark has been reached and not the low watermark
+  volatile uint32_t _tsOldest;  /// millis() when the number of items not yet read last changed from 0
+  uint8_t   _batchLeft; /// items of a ready batch not yet returned by readBatch()
+  uint8_t   _batchSize; /// current suggested batch size
+  uint8_t   _batchMin;  /// smallest suggested batch size
+  uint8_t   _batchMax;  /// largest suggested batch size
+  uint8_t   _batchStep; /// additive increase in the batch size
 };
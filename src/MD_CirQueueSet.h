@@ -0,0 +1,271 @@
+#pragma once
+
+#include <MD_CirQueue.h>
+
+/**
+ * \file
+ * \brief Header file and class definition for the MD_CirQueueSet queue scheduler
+ */
+
+/**
+ * Fair scheduler for a set of queues in the MD_CirQueue library
+ *
+ * Where one consumer services many queues (eg, one for each client), checking
+ * each queue in turn wastes time on the empty queues and lets busy queues hold
+ * up the others. A queue set keeps a list of only the member queues that have
+ * items and pop() takes items from them using deficit round robin - each queue
+ * in turn may take up to its quantum of items (or bytes) before moving on to
+ * the next queue, with any unused share carried to its next turn.
+ *
+ * The set uses the event callback of its member queues (see
+ * MD_CirQueue::setEventCallback()) to find out when an empty queue gets an item.
+ * The member queues can still be used directly, including pop().
+ */
+class MD_CirQueueSet
+{
+public:
+  static const uint8_t NO_QUEUE = 0xff;   ///< index returned when there is no queue
+
+  /**
+   * Class Constructor.
+   *
+   * Instantiate a new instance of the class. The parameters passed are used to
+   * configure the number of queues in the set and how the quantum is counted.
+   *
+   * \param qtyMax    maximum number of queues in the set, up to 254.
+   * \param byBytes   true to count the quantum in bytes, false (default) to count in items.
+   */
+  MD_CirQueueSet(uint8_t qtyMax, bool byBytes = false) :
+    _qtyMax(qtyMax > 254 ? 254 : qtyMax), _qtyCount(0), _byBytes(byBytes),
+    _started(false), _active(_qtyMax, sizeof(uint8_t))
+  {
+    CQ_PRINT("\nAllocating members ", _qtyMax);
+    _member = (member_t *)malloc(sizeof(member_t) * _qtyMax);
+  }
+
+  /**
+   * Class Destructor.
+   *
+   * Released allocated memory and does the necessary to clean up once the set is
+   * no longer required. The event callback of the member queues is removed.
+   */
+  ~MD_CirQueueSet()
+  {
+    for (uint8_t i = 0; i < _qtyCount; i++)
+      _member[i].q->setEventCallback(NULL);
+    free(_member);
+  }
+
+  /**
+   * Initialize the object.
+   *
+   * Initialize the object data. This needs to be called during setup() to initialize new
+   * data for the class that cannot be done during the object creation.
+   */
+  void begin(void) {};
+
+ /**
+  * Add a queue to the set
+  *
+  * The queue is added to the set with the quantum specified. The set takes over the
+  * event callback of the queue.
+  *
+  * @param q        pointer to the queue to add.
+  * @param quantum  the number of items (or bytes) the queue may supply in each turn, default 1.
+  * @return the index of the queue in the set, or NO_QUEUE if the set is full
+  */
+  uint8_t add(MD_CirQueue* q, uint16_t quantum = 1)
+  {
+    if (_qtyCount >= _qtyMax) return(NO_QUEUE);
+
+    uint8_t id = _qtyCount++;
+    member_t* m = &_member[id];
+
+    m->q = q;
+    m->set = this;
+    m->id = id;
+    m->quantum = (quantum == 0 ? 1 : quantum);
+    m->deficit = 0;
+    m->active = false;
+    q->setEventCallback(callback, m);
+    if (!q->isEmpty()) activate(m);
+
+    return(id);
+  }
+
+ /**
+  * Set the quantum for a queue in the set
+  *
+  * @param id       the index of the queue returned by add().
+  * @param quantum  the number of items (or bytes) the queue may supply in each turn.
+  */
+  inline void setQuantum(uint8_t id, uint16_t quantum) { if (id < _qtyCount) _member[id].quantum = (quantum == 0 ? 1 : quantum); };
+
+ /**
+  * Pop an item from the next queue in turn
+  *
+  * Return an item from the member queue whose turn it is, copied into the buffer
+  * specified, returning a pointer to the copied item. If all the member queues are
+  * empty, then no data is copied and the method returns a NULL pointer.
+  *
+  * @param itm  a pointer to data buffer for the retrieved item to be saved. This must be large enough for the largest member queue item.
+  * @param id   optional pointer to a variable to receive the index of the queue the item came from.
+  * @return pointer to the memory buffer or NULL if all the queues are empty
+  */
+  uint8_t *pop(uint8_t* itm, uint8_t* id = NULL)
+  {
+    uint8_t i;
+
+    while (_active.peek(&i) != NULL)
+    {
+      member_t* m = &_member[i];
+      uint16_t cost = (_byBytes ? m->q->getItemSize() : 1);
+
+      // start of this queue's turn
+      if (!_started)
+      {
+        m->deficit += m->quantum;
+        _started = true;
+      }
+
+      if (m->deficit >= cost && m->q->pop(itm) != NULL)
+      {
+        CQ_PRINT("\nSet pop Q", i);
+        m->deficit -= cost;
+        if (id != NULL) *id = i;
+        if (m->q->isEmpty()) endTurn();
+        return(itm);
+      }
+
+      endTurn();
+    }
+
+    return(NULL);
+  }
+
+ /**
+  * Find a queue with items
+  *
+  * Returns the index of the member queue whose turn it is, without removing any
+  * items. A consumer can use this to service the queue directly instead of using
+  * pop().
+  *
+  * @return the index of a queue with items, or NO_QUEUE if all the queues are empty
+  */
+  uint8_t ready(void)
+  {
+    uint8_t i;
+
+    while (_active.peek(&i) != NULL)
+    {
+      if (!_member[i].q->isEmpty()) return(i);
+      endTurn();
+    }
+
+    return(NO_QUEUE);
+  }
+
+ /**
+  * Wait for a queue with items
+  *
+  * Waits until any member queue has items or the timeout expires, returning the
+  * index of the queue whose turn it is, as for ready(). Only the list of active
+  * queues is checked while waiting, however many queues are in the set. yield()
+  * is called while waiting so that background tasks on the processor can run.
+  * The queues may be filled from interrupt service routines while waiting (see
+  * CQ_ISR_SAFE).
+  *
+  * @param timeout  the maximum time to wait in milliseconds.
+  * @return the index of a queue with items, or NO_QUEUE if the timeout expired
+  */
+  uint8_t wait(uint32_t timeout)
+  {
+    uint32_t start = millis();
+    uint8_t id;
+
+    while ((id = ready()) == NO_QUEUE)
+    {
+      if (millis() - start >= timeout) break;
+      yield();
+    }
+
+    return(id);
+  }
+
+ /**
+  * Check if all the queues in the set are empty
+  *
+  * @return true if all the member queues are empty, false otherwise
+  */
+  inline bool isEmpty(void) { return(_active.isEmpty()); };
+
+private:
+  /**
+   * Member queue details, also the context pointer for the queue event callback.
+   */
+  typedef struct
+  {
+    MD_CirQueue*    q;        ///< the member queue
+    MD_CirQueueSet* set;      ///< the set this queue belongs to
+    uint8_t         id;       ///< index of the queue in the set
+    uint16_t        quantum;  ///< share of items or bytes added to the deficit in each turn
+    uint16_t        deficit;  ///< items or bytes the queue can still supply
+    volatile bool   active;   ///< true when the queue is in the active list
+  } member_t;
+
+  static void callback(MD_CirQueue*, MD_CirQueue::event_t evt, void* ctx)
+  {
+    member_t* m = (member_t*)ctx;
+
+    if (evt == MD_CirQueue::EVT_NOT_EMPTY) m->set->activate(m);
+  }
+
+ /**
+  * Add a queue to the end of the active list if it is not already there.
+  */
+  void activate(member_t* m)
+  {
+    CQ_LOCK();
+    if (!m->active)
+    {
+      CQ_PRINT("\nActivate Q", m->id);
+      m->active = true;
+      _active.push(&m->id);
+    }
+    CQ_UNLOCK();
+  }
+
+ /**
+  * End the turn of the queue at the head of the active list, moving it to the
+  * end of the list or removing it from the list if it is empty.
+  */
+  void endTurn(void)
+  {
+    uint8_t i;
+
+    // an item pushed from an interrupt must not be missed between the empty
+    // check and clearing the active flag
+    CQ_LOCK();
+    _active.pop(&i);
+    _started = false;
+
+    member_t* m = &_member[i];
+
+    if (m->q->isEmpty())
+    {
+      CQ_PRINT("\nDeactivate Q", i);
+      m->deficit = 0;
+      m->active = false;
+    }
+    else
+      _active.push(&i);
+    CQ_UNLOCK();
+  }
+
+  uint8_t     _qtyMax;    /// maximum number of queues in the set
+  uint8_t     _qtyCount;  /// number of queues in the set
+  bool        _byBytes;   /// when true the quantum is in bytes, otherwise in items
+  bool        _started;   /// true when the queue at the head of the active list has started its turn
+  member_t*   _member;    /// pointer to allocated array of member details
+  MD_CirQueue _active;    /// list of indices of the queues with items, in turn order
+};
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <MD_CirQueue.h>
+
+/**
+ * \file
+ * \brief Header file and class definition for the MD_CirReorder reorder buffer
+ */
+
+/**
+ * Sequence number reorder buffer for the MD_CirQueue library
+ *
+ * Data received over a network or radio link can arrive slightly out of order.
+ * Each item pushed into this buffer carries a sequence number and is placed
+ * directly into its slot in the buffer. Items are popped strictly in sequence
+ * number order, so no sorting is needed.
+ *
+ * If the next item in sequence is missing while later items are waiting, pop()
+ * waits for it for the gap timeout and then skips over the missing items.
+ */
+class MD_CirReorder
+{
+public:
+  /**
+   * Class Constructor.
+   *
+   * Instantiate a new instance of the class. The parameters passed are used to
+   * configure the quantity and size of buffer items.
+   *
+   * \param itmQty    number of items in the buffer, which is also how far ahead of the next sequence number an item can be.
+   * \param itmSize   size of each item in bytes.
+   */
+  MD_CirReorder(uint8_t itmQty, uint16_t itmSize) :
+    _itmQty(itmQty), _itmSize(itmSize), _gapTimeout(0)
+  {
+    uint16_t size = sizeof(uint8_t) * _itmQty * _itmSize;
+
+    CQ_PRINT("\nAllocating ", size);
+    CQ_PRINTS("bytes");
+    _itmData = (uint8_t *)malloc(size);
+    _itmValid = (uint8_t *)malloc((_itmQty + 7) / 8);
+    clear();
+  }
+
+  /**
+   * Class Destructor.
+   *
+   * Released allocated memory and does the necessary to clean up once the buffer is
+   * no longer required.
+   */
+  ~MD_CirReorder()
+  {
+    free(_itmData);
+    free(_itmValid);
+  }
+
+  /**
+   * Initialize the object.
+   *
+   * Initialize the object data. This needs to be called during setup() to initialize new
+   * data for the class that cannot be done during the object creation.
+   */
+  void begin(void) {};
+
+ /**
+  * Clear contents of buffer
+  *
+  * Discards all the items in the buffer and sets the sequence number of the next
+  * item to be popped.
+  *
+  * @param seq  the sequence number of the next item expected, default 0.
+  */
+  void clear(uint32_t seq = 0)
+  {
+    memset(_itmValid, 0, (_itmQty + 7) / 8);
+    _seqNext = seq;
+    _idxNext = _itmCount = 0;
+    _skipCount = 0;
+    _waiting = false;
+  }
+
+ /**
+  * Push an item into the buffer
+  *
+  * Place the item passed into the slot for its sequence number. The push fails if
+  * the sequence number has already been popped or skipped, or is too far ahead
+  * of the next sequence number to fit in the buffer. Pushing a sequence number
+  * already in the buffer replaces the earlier item.
+  *
+  * @param seq    the sequence number of the item.
+  * @param itm    a pointer to data buffer of the item to be saved. Data size must be size specified in the constructor.
+  * @return true  if the item was successfully placed in the buffer, false otherwise
+  */
+  bool push(uint32_t seq, uint8_t* itm)
+  {
+    uint32_t d = seq - _seqNext;   // also rejects old items, as these wrap to large numbers
+
+    if (d >= _itmQty) return(false);
+
+    uint8_t idx = getIndex((uint8_t)d);
+
+    CQ_PRINT("\nPush @", idx);
+    memcpy(_itmData + (_itmSize * idx), itm, _itmSize);
+    if (!isValid(idx))
+    {
+      setValid(idx, true);
+      _itmCount++;
+    }
+
+    return(true);
+  }
+
+ /**
+  * Pop the next item in sequence from the buffer
+  *
+  * Return the item with the next sequence number, copied into the buffer specified,
+  * returning a pointer to the copied item. If that item has not been received, no
+  * data is copied and the method returns a NULL pointer. If later items are
+  * waiting and the item has been missing for longer than the gap timeout, the
+  * missing items are skipped and the next available item is returned.
+  *
+  * @param itm  a pointer to data buffer for the retrieved item to be saved. Data size must be size specified in the constructor.
+  * @param seq  optional pointer to a variable to receive the item sequence number.
+  * @return pointer to the memory buffer or NULL if the next item is not available
+  */
+  uint8_t *pop(uint8_t* itm, uint32_t* seq = NULL)
+  {
+    if (isEmpty()) return(NULL);
+
+    if (!isValid(_idxNext))
+    {
+      // time the gap from when it is first found
+      if (!_waiting)
+      {
+        _waiting = true;
+        _gapStart = millis();
+      }
+      if (_gapTimeout == 0 || millis() - _gapStart < _gapTimeout)
+        return(NULL);
+
+      // give up on the missing items
+      while (!isValid(_idxNext))
+      {
+        CQ_PRINT("\nSkip ", _seqNext);
+        advance();
+        _skipCount++;
+      }
+    }
+
+    CQ_PRINT("\nPop @", _idxNext);
+    memcpy(itm, _itmData + (_itmSize * _idxNext), _itmSize);
+    if (seq != NULL) *seq = _seqNext;
+    setValid(_idxNext, false);
+    _itmCount--;
+    advance();
+    _waiting = false;
+
+    return(itm);
+  }
+
+ /**
+  * Set the gap timeout
+  *
+  * Sets how long pop() waits for a missing item, while later items are available,
+  * before skipping it. The default is 0, which waits for missing items forever.
+  *
+  * @param t  the timeout in milliseconds, 0 to disable skipping
+  */
+  inline void setGapTimeout(uint32_t t) { _gapTimeout = t; };
+
+ /**
+  * Get the sequence number of the next item to be popped
+  *
+  * @return the next sequence number
+  */
+  inline uint32_t getNextSequence(void) { return(_seqNext); };
+
+ /**
+  * Get the number of items skipped
+  *
+  * @return the number of missing items skipped since the buffer was cleared
+  */
+  inline uint32_t getSkipCount(void) { return(_skipCount); };
+
+ /**
+  * Check if the buffer is empty
+  *
+  * @return true if empty, false otherwise
+  */
+  inline bool isEmpty(void) { return(_itmCount == 0); };
+
+private:
+  inline uint8_t getIndex(uint8_t ahead)
+  {
+    uint16_t i = _idxNext + ahead;
+
+    if (i >= _itmQty) i -= _itmQty;
+    return(i);
+  }
+
+  inline bool isValid(uint8_t idx) { return((_itmValid[idx >> 3] & (1 << (idx & 7))) != 0); };
+
+  inline void setValid(uint8_t idx, bool b)
+  {
+    if (b) _itmValid[idx >> 3] |= (1 << (idx & 7));
+    else   _itmValid[idx >> 3] &= ~(1 << (idx & 7));
+  }
+
+  inline void advance(void)
+  {
+    if (++_idxNext == _itmQty) _idxNext = 0;
+    _seqNext++;
+  }
+
+  uint8_t   _itmQty;    /// number of items in the buffer
+  uint16_t  _itmSize;   /// size in bytes for each item
+  uint8_t*  _itmData;   /// pointer to allocated memory buffer
+  uint8_t*  _itmValid;  /// pointer to allocated bit flags, set when a slot holds an item
+
+  uint8_t   _itmCount;  /// number of items in the buffer
+  uint8_t   _idxNext;   /// array index of the next item to pop
+  uint32_t  _seqNext;   /// sequence number of the next item to pop
+  uint32_t  _skipCount; /// number of missing items skipped
+  uint32_t  _gapTimeout;/// time in ms to wait for a missing item, 0 to wait forever
+  uint32_t  _gapStart;  /// millis() when the current gap was found
+  bool      _waiting;   /// true when timing a gap
+};